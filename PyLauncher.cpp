@@ -1,80 +1,42 @@
 #include "stdafx.h"
 #include "parsing.h"
+#include "discovery.h"
 #include "errors.h"
+#include "versions.h"
 
-using std::make_unique;
-using std::vector;
-using std::wstring;
+using std::pmr::vector;
+using std::pmr::wstring;
 
 bool verbose = false;
 
-struct python_version {
-    wstring tag;
-    wstring install_path;
-    wstring exe_name;
-    int major, minor, priority;
-
-    static const python_version invalid;
-
-    python_version() { }
-
-    python_version(wchar_t *tag, wchar_t *install_path, wchar_t *exe_name, int priority)
-        : tag(tag), install_path(install_path), exe_name(exe_name), priority(priority) {
-        wchar_t *c1 = tag, *c2;
-        major = std::wcstoul(c1, &c2, 10);
-        if (c1 == c2) {
-            major = 0;
-        } else if (*c2) {
-            c1 = c2 + 1;
-            minor = std::wcstoul(c1, &c2, 10);
-            if (c1 == c2) {
-                minor = 0;
-            }
-        }
-    }
+#ifdef _DEBUG
+#include <atomic>
+#include <cstdlib>
+#include <new>
 
-    bool is_valid() const {
-        return !tag.empty();
-    }
+// Counts calls to the global allocator so that tests can check that a launch
+// is served entirely from the arena in main().
+std::atomic<size_t> heap_allocations = 0;
 
-    wstring full_path() const {
-        wstring res;
-        res.reserve(install_path.size() + exe_name.size() + 1);
-        res.assign(install_path);
-        if (res.length() && res.back() != '\\') {
-            res.append(L"\\");
-        }
-        res.append(exe_name);
-        return res;
+void *operator new(size_t size) {
+    ++heap_allocations;
+    if (auto p = std::malloc(size ? size : 1)) {
+        return p;
     }
+    throw std::bad_alloc();
+}
 
-    bool operator==(const python_version& other) const {
-        return major == other.major && minor == other.minor && tag == other.tag;
-    }
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+#endif
 
-    bool operator<(const python_version& other) const {
-        if (major > other.major) {
-            return true;
-        } else if (major < other.major) {
-            return false;
-        }
-        if (minor > other.minor) {
-            return true;
-        } else if (minor < other.minor) {
-            return false;
-        }
-        if (priority < other.priority) {
-            return true;
-        } else if (priority > other.priority) {
-            return false;
-        }
-        return tag < other.tag;
+void enum_reg(python_versions &versions, HKEY hKey, int priority, bool preferW, bool onlyX86) {
+    DWORD subkeyCount;
+    if (RegQueryInfoKeyW(hKey, nullptr, nullptr, nullptr, &subkeyCount, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr) == ERROR_SUCCESS) {
+        versions.reserve(subkeyCount);
     }
-};
 
-const python_version python_version::invalid;
-
-void enum_reg(vector<python_version> &versions, HKEY hKey, int priority, bool preferW, bool onlyX86) {
     for (DWORD i = 0; ; ++i) {
         wchar_t name[64];
         DWORD cchName = 64;
@@ -101,7 +63,9 @@ void enum_reg(vector<python_version> &versions, HKEY hKey, int priority, bool pr
         if (res != ERROR_SUCCESS) {
             if (res != ERROR_FILE_NOT_FOUND) {
                 auto err = GetLastError();
-                print_error(err, wstring(L"opening subkey ") + subkeyName);
+                wchar_t message[256];
+                swprintf_s(message, L"opening subkey %s", subkeyName);
+                print_error(err, message);
             }
             continue;
         }
@@ -112,7 +76,9 @@ void enum_reg(vector<python_version> &versions, HKEY hKey, int priority, bool pr
         if (res != ERROR_SUCCESS) {
             if (res != ERROR_FILE_NOT_FOUND) {
                 auto err = GetLastError();
-                print_error(err, wstring(L"reading ") + subkeyName);
+                wchar_t message[256];
+                swprintf_s(message, L"reading %s", subkeyName);
+                print_error(err, message);
             }
             if (RegCloseKey(subkey) != ERROR_SUCCESS) {
                 auto err = GetLastError();
@@ -128,7 +94,9 @@ void enum_reg(vector<python_version> &versions, HKEY hKey, int priority, bool pr
             wcscpy_s(exe_name, preferW ? L"pythonw.exe" : L"python.exe");
         } else if (res != ERROR_SUCCESS) {
             auto err = GetLastError();
-            print_error(err, wstring(L"reading exe name from ") + subkeyName);
+            wchar_t message[256];
+            swprintf_s(message, L"reading exe name from %s", subkeyName);
+            print_error(err, message);
             if (RegCloseKey(subkey) != ERROR_SUCCESS) {
                 auto err = GetLastError();
                 print_error(err, L"closing subkey");
@@ -141,7 +109,99 @@ void enum_reg(vector<python_version> &versions, HKEY hKey, int priority, bool pr
             print_error(err, L"closing subkey");
         }
 
-        auto fullPath = wstring(path) + L"\\" + exe_name;
+        wchar_t fullPath[_countof(path) + _countof(exe_name)];
+        if (swprintf_s(fullPath, L"%s\\%s", path, exe_name) < 0) {
+            print_error(ERROR_INVALID_PARAMETER, L"formatting executable path");
+            continue;
+        }
+        DWORD binaryType;
+        if (!GetBinaryTypeW(fullPath, &binaryType)) {
+            if (verbose) {
+                wprintf_s(L"Cannot get file at %s\n", fullPath);
+            }
+            continue;
+        }
+
+        if (onlyX86 && binaryType != SCS_32BIT_BINARY) {
+            if (verbose) {
+                wprintf_s(L"Skipping non x86 %s\n", fullPath);
+            }
+            continue;
+        }
+
+        if (versions.add(name, path, exe_name, priority)) {
+            if (verbose) {
+                wprintf_s(L"- %-16s: %s\\%s\n", name, path, exe_name);
+            }
+        }
+    }
+}
+
+// Used when PYLAUNCHER_SEARCH_PATH is not set. Environment variables are
+// expanded, and roots that do not exist are skipped. Setting the variable to
+// an empty value disables the search.
+const wchar_t DEFAULT_SEARCH_PATH[] =
+    L"%LOCALAPPDATA%\\Programs\\Python;"
+    L"%USERPROFILE%\\.pyenv\\pyenv-win\\versions;"
+    L"%USERPROFILE%\\.pyenv\\versions;"
+    L"%USERPROFILE%\\Anaconda3\\envs;"
+    L"%USERPROFILE%\\Miniconda3\\envs";
+
+// Deep enough for nuget packages ({root}\{package}\tools\python.exe)
+const int SEARCH_DEPTH = 3;
+
+vector<wstring> get_search_roots(std::pmr::memory_resource *mem) {
+    vector<wstring> roots(mem);
+    wchar_t path[32767];
+    SetLastError(ERROR_SUCCESS);
+    if (!GetEnvironmentVariableW(L"PYLAUNCHER_SEARCH_PATH", path, 32767)) {
+        if (GetLastError() != ERROR_ENVVAR_NOT_FOUND) {
+            if (verbose) {
+                wprintf_s(L"PYLAUNCHER_SEARCH_PATH is empty\n");
+            }
+            return roots;
+        }
+        wcscpy_s(path, DEFAULT_SEARCH_PATH);
+    }
+
+    wchar_t expanded[32767];
+    if (!ExpandEnvironmentStringsW(path, expanded, 32767)) {
+        auto err = GetLastError();
+        print_error(err, L"expanding search path");
+        return roots;
+    }
+
+    wchar_t *start = expanded;
+    for (wchar_t *c = expanded; ; ++c) {
+        if (*c == L';' || !*c) {
+            if (c != start) {
+                roots.emplace_back(start, c);
+            }
+            if (!*c) {
+                break;
+            }
+            start = c + 1;
+        }
+    }
+    return roots;
+}
+
+void enum_dirs(python_versions &versions, const vector<wstring> &roots, int priority, bool preferW, bool onlyX86) {
+    // The walker allocates from the heap on its own threads, so only start it
+    // when there is something to walk.
+    std::vector<std::wstring> existing;
+    for (const auto &root : roots) {
+        auto attr = GetFileAttributesW(root.c_str());
+        if (attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY)) {
+            existing.emplace_back(root.cbegin(), root.cend());
+        }
+    }
+    if (existing.empty()) {
+        return;
+    }
+
+    for (const auto &python : find_unregistered_pythons(existing, SEARCH_DEPTH, preferW)) {
+        auto fullPath = python.install_path + L"\\" + python.exe_name;
         DWORD binaryType;
         if (!GetBinaryTypeW(fullPath.c_str(), &binaryType)) {
             if (verbose) {
@@ -157,44 +217,48 @@ void enum_reg(vector<python_version> &versions, HKEY hKey, int priority, bool pr
             continue;
         }
 
-        versions.emplace_back(name, path, exe_name, priority);
-        auto existing = std::find(versions.begin(), versions.end(), *(versions.end() - 1));
-        if (existing != versions.end() && existing != versions.end() - 1) {
-            versions.pop_back();
-        } else {
+        if (versions.add(python.tag.c_str(), python.install_path.c_str(), python.exe_name.c_str(), priority)) {
             if (verbose) {
-                wprintf_s(L"- %-16s: %s\\%s\n", name, path, exe_name);
+                wprintf_s(L"- %-16s: %s\n", python.tag.c_str(), fullPath.c_str());
             }
         }
     }
 }
 
-auto find_python(const vector<python_version>& known, const wstring& version) -> decltype(known.begin()) {
+auto find_python(const python_versions& known, std::wstring_view version) -> decltype(known.begin()) {
     if (verbose) {
-        wprintf_s(L"Finding match for %s\n", version.c_str());
+        wprintf_s(L"Finding match for %.*s\n", static_cast<int>(version.length()), version.data());
     }
     return std::find_if(known.begin(), known.end(), [&](const python_version &pv) {
+        auto tag = known.str(pv.tag);
         if (verbose) {
-            wprintf_s(L" considering %s\n", pv.tag.c_str());
+            wprintf_s(L" considering %s\n", tag);
         }
-        if (pv.tag.length() < version.length()) {
-            return false;
-        }
-        return std::equal(
-            version.begin(), version.end(),
-            pv.tag.begin(), pv.tag.begin() + version.length()
-        );
+        return wcsncmp(tag, version.data(), version.length()) == 0;
     });
 
 }
 
-bool is_env_set(const wstring& name) {
+auto select_python(const python_versions& known, const wstring& version, bool onlyX86) -> decltype(known.begin()) {
+    if (!version.length()) {
+        return known.begin();
+    }
+
+    auto selected = find_python(known, version);
+
+    if (selected == known.end() && onlyX86 && version.length() > 3) {
+        selected = find_python(known, { version.data(), version.length() - 3 });
+    }
+    return selected;
+}
+
+bool is_env_set(const wchar_t *name) {
     wchar_t buffer[1024];
-    if (!GetEnvironmentVariableW(name.c_str(), buffer, 1024) || buffer[0] == '0' && !buffer[1]) {
+    if (!GetEnvironmentVariableW(name, buffer, 1024) || buffer[0] == '0' && !buffer[1]) {
         return false;
     }
     if (verbose) {
-        wprintf(L"%s was set\n", name.c_str());
+        wprintf(L"%s was set\n", name);
     }
     return true;
 }
@@ -226,8 +290,9 @@ bool parse_version_from_program_name(const wstring &program, wstring *version, b
     return true;
 }
 
-python_version find_suitable_version(wstring version) {
-    vector<python_version> pythons;
+wstring find_suitable_version(const wstring &versionArg, std::pmr::memory_resource *mem) {
+    wstring version(versionArg, mem);
+    python_versions pythons(mem);
     bool preferW = false;
     bool onlyX86 = false;
 
@@ -296,65 +361,184 @@ python_version find_suitable_version(wstring version) {
         print_error(err, L"scanning HKEY_LOCAL_MACHINE (32-bit)");
     }
 
-    std::sort(pythons.begin(), pythons.end());
-
-    auto selected = pythons.cbegin();
-
-    if (version.length()) {
-        auto vb = version.begin(), ve = version.end();
-        selected = find_python(pythons, { vb, ve });
-
-        if (selected == pythons.end() && onlyX86 && version.length() > 3) {
-            ve -= 3;
-            selected = find_python(pythons, { vb, ve });
+    auto roots = get_search_roots(mem);
+    if (verbose) {
+        for (const auto &root : roots) {
+            wprintf_s(L"Searching %s\n", root.c_str());
         }
     }
+    enum_dirs(pythons, roots, 4, preferW, onlyX86);
+
+    pythons.sort();
+    auto selected = select_python(pythons, version, onlyX86);
 
     if (selected == pythons.end()) {
         if (verbose) {
             wprintf_s(L"No suitable interpreter found\n");
         }
         // TODO: Download and install Python
-        return python_version::invalid;
+        return wstring(mem);
     }
 
-    return *selected;
+    return pythons.full_path(*selected);
+}
+
+// Returns the length of the command line that join_args would build, so that
+// an overlong line can be detected without building it.
+template<typename iter>
+size_t command_line_length(iter start, iter end) {
+    size_t length = 0;
+    for (auto a = start; a != end; ++a) {
+        if (a != start) {
+            length += 1;
+        }
+        if (a->empty()) {
+            length += 2;
+        } else if (std::find(a->cbegin(), a->cend(), L' ') != a->cend()) {
+            length += a->length() + (a->back() == L'\\' ? 3 : 2);
+        } else {
+            length += a->length();
+        }
+    }
+    return length;
 }
 
 template<typename iter>
-wstring join_args(iter start, iter end) {
-    std::wostringstream message;
+wstring join_args(iter start, iter end, std::pmr::memory_resource *mem) {
+    wstring message(mem);
+    message.reserve(command_line_length(start, end));
     bool first = true;
     for (; start != end; ++start) {
         if (!first) {
-            message << L' ';
+            message.push_back(L' ');
         }
         first = false;
 
         auto &a = *start;
         if (a.empty()) {
-            message << L'"' << L'"';
+            message.append(L"\"\"");
         } else if (std::find(a.cbegin(), a.cend(), L' ') != a.cend()) {
-            message << L'"' << a;
+            message.push_back(L'"');
+            message.append(a);
             if (a.back() == L'\\') {
-                message << L'\\';
+                message.push_back(L'\\');
             }
-            message << L'"';
+            message.push_back(L'"');
         } else {
-            message << a;
+            message.append(a);
         }
     }
 
-    return message.str();
+    return message;
+}
+
+// CreateProcess rejects command lines longer than this, including the
+// terminating null.
+const size_t MAX_COMMAND_LINE = 32767;
+
+// Writes the arguments following the script to a temporary response file and
+// builds a command line that passes '@{responseFile}' in their place.
+// Arguments are written one per line as UTF-8, which is what argparse's
+// fromfile_prefix_chars expects, so only scripts that accept response files
+// can be launched with very long command lines. The caller deletes the file
+// once the script has exited.
+bool spill_to_response_file(const vector<wstring> &args, wstring *commandLine, wchar_t (&responseFile)[MAX_PATH + 1]) {
+    bool is_code;
+    auto script = find_script(args, 1, &is_code);
+    if (script + 1 >= args.size()) {
+        print_error(ERROR_FILENAME_EXCED_RANGE, L"building command line");
+        return false;
+    }
+
+    wchar_t tempDir[MAX_PATH + 1];
+    if (!GetTempPathW(MAX_PATH + 1, tempDir) || !GetTempFileNameW(tempDir, L"pyl", 0, responseFile)) {
+        auto err = GetLastError();
+        print_error(err, L"creating response file");
+        responseFile[0] = L'\0';
+        return false;
+    }
+
+    // The interpreter options that remain may still be too long on their own
+    bool quote = wcschr(responseFile, L' ') != nullptr;
+    auto length = command_line_length(args.cbegin(), args.cbegin() + script + 1) + 2 + wcslen(responseFile) + (quote ? 2 : 0);
+    if (length >= MAX_COMMAND_LINE) {
+        print_error(ERROR_FILENAME_EXCED_RANGE, L"building command line");
+        DeleteFileW(responseFile);
+        responseFile[0] = L'\0';
+        return false;
+    }
+
+    auto hFile = CreateFileW(responseFile, GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        auto err = GetLastError();
+        print_error(err, L"opening response file");
+        DeleteFileW(responseFile);
+        responseFile[0] = L'\0';
+        return false;
+    }
+
+    // Convert and write in batches rather than building the whole file
+    const size_t BATCH_SIZE = 64 * 1024;
+    auto mem = commandLine->get_allocator().resource();
+    std::pmr::string buffer(mem);
+    buffer.reserve(BATCH_SIZE);
+    BOOL success = TRUE;
+    DWORD written;
+    for (auto a = args.cbegin() + script + 1; success && a != args.cend(); ++a) {
+        if (!a->empty()) {
+            int cch = static_cast<int>(a->length());
+            int cb = WideCharToMultiByte(CP_UTF8, 0, a->data(), cch, nullptr, 0, nullptr, nullptr);
+            auto offset = buffer.size();
+            buffer.resize(offset + cb);
+            WideCharToMultiByte(CP_UTF8, 0, a->data(), cch, buffer.data() + offset, cb, nullptr, nullptr);
+        }
+        buffer.push_back('\n');
+        if (buffer.size() >= BATCH_SIZE || a + 1 == args.cend()) {
+            success = WriteFile(hFile, buffer.data(), static_cast<DWORD>(buffer.size()), &written, nullptr);
+            buffer.clear();
+        }
+    }
+    auto err = GetLastError();
+    CloseHandle(hFile);
+    if (!success) {
+        print_error(err, L"writing response file");
+        DeleteFileW(responseFile);
+        responseFile[0] = L'\0';
+        return false;
+    }
+
+    *commandLine = join_args(args.cbegin(), args.cbegin() + script + 1, mem);
+    commandLine->reserve(length);
+    commandLine->append(quote ? L" \"@" : L" @");
+    commandLine->append(responseFile);
+    if (quote) {
+        commandLine->push_back(L'"');
+    }
+
+    if (verbose) {
+        wprintf_s(L"Wrote %zu arguments to %s\n", args.size() - script - 1, responseFile);
+    }
+    return true;
 }
 
 int main() {
-    wstring version;
+#ifdef _DEBUG
+    auto initial_heap_allocations = heap_allocations.load();
+#endif
+
+    // Everything allocated while parsing, discovering and building the command
+    // line comes from this arena, which is passed explicitly to each container
+    // rather than installed as the default resource. It falls back to the heap
+    // if it fills up.
+    std::byte arena_buffer[64 * 1024];
+    std::pmr::monotonic_buffer_resource arena(arena_buffer, sizeof(arena_buffer), std::pmr::new_delete_resource());
+
+    wstring version(&arena);
 
     verbose = is_env_set(L"PYLAUNCHER_VERBOSE");
     auto noLaunch = is_env_set(L"PYLAUNCHER_NOLAUNCH");
 
-    auto args = parse_args(GetCommandLineW(), &version);
+    auto args = parse_args(GetCommandLineW(), &version, &arena);
 
     if (args.size() == 0) {
         wprintf_s(L"Invalid arguments!");
@@ -362,7 +546,7 @@ int main() {
     }
 
     if (verbose) {
-        auto message = join_args(args.cbegin(), args.cend());
+        auto message = join_args(args.cbegin(), args.cend(), &arena);
         wprintf_s(L"Args: %s\n", message.c_str());
     }
 
@@ -371,16 +555,34 @@ int main() {
             wprintf_s(L"Found version: %s\n", version.c_str());
         }
 
-        auto python = find_suitable_version(version);
-        if (!python.is_valid()) {
+        auto python = find_suitable_version(version, &arena);
+        if (python.empty()) {
             return -1;
         }
-        args[0] = python.full_path();
+        args[0] = python;
+    }
+
+    wstring commandLine(&arena);
+    wchar_t responseFile[MAX_PATH + 1] = { 0 };
+    auto length = command_line_length(args.cbegin(), args.cend());
+    if (length < MAX_COMMAND_LINE) {
+        commandLine = join_args(args.cbegin(), args.cend(), &arena);
+    } else if (noLaunch) {
+        // Nothing is written to disk when not launching
+        wprintf_s(L"Command line is %zu characters, so arguments would be passed in a response file\n", length);
+        return 0;
+    } else if (!spill_to_response_file(args, &commandLine, responseFile)) {
+        return -1;
     }
 
+#ifdef _DEBUG
+    if (verbose) {
+        wprintf_s(L"Heap allocations: %zu\n", heap_allocations.load() - initial_heap_allocations);
+    }
+#endif
+
     if (noLaunch || verbose) {
-        auto message = join_args(args.cbegin(), args.cend());
-        wprintf_s(L"Selected: %s\n", message.c_str());
+        wprintf_s(L"Selected: %s\n", commandLine.c_str());
     }
 
     if (noLaunch) {
@@ -389,6 +591,13 @@ int main() {
 
     // TODO: Launch
 
+    // The child has exited by the time the launch returns, so any spilled
+    // arguments are no longer needed
+    if (responseFile[0] && !DeleteFileW(responseFile)) {
+        auto err = GetLastError();
+        print_error(err, L"deleting response file");
+    }
+
     return 0;
 }
 
@@ -0,0 +1,44 @@
+﻿import os
+import subprocess
+import sys
+import tempfile
+import unittest
+import win32file
+
+class Test_allocation(unittest.TestCase):
+    def _run(self, args):
+        # The filesystem walk allocates on its own threads, so disable it with
+        # an empty search path. This is passed as a whole block, since assigning
+        # an empty value through os.environ may remove the variable instead.
+        env = dict(os.environ)
+        env["PYLAUNCHER_NOLAUNCH"] = "1"
+        env["PYLAUNCHER_VERBOSE"] = "1"
+        env["PYLAUNCHER_SEARCH_PATH"] = ""
+        out = subprocess.check_output(
+            [self._python] + args,
+            stderr=subprocess.STDOUT,
+            env=env,
+        )
+        res = out.decode('utf-8')
+        print(res)
+        return res.splitlines()
+
+    def __init__(self, methodName = 'runTest'):
+        super().__init__(methodName)
+        self._python = os.path.abspath(os.path.join(os.path.split(__file__)[0], '..', 'Debug', 'python.exe'))
+        self.version = "{0[0]}.{0[1]}{1}".format(sys.version_info, '-32' if sys.maxsize < 2**32 else '')
+
+    def test_version_argument(self):
+        lines = self._run([self.version, "-c", "import sys; print(sys.argv)", "an argument"])
+        self.assertIn("Heap allocations: 0", lines)
+
+    def test_shebang(self):
+        fn = os.path.join(tempfile.gettempdir(), "allocation.py")
+        with win32file.open(fn, writable=True, delete_on_close=True, encoding='utf-8') as f:
+            f.writelines(["#! /usr/bin/env python" + self.version + " -u\r\n", "\r\n"])
+            f.flush()
+            lines = self._run([f.path, "an argument"])
+        self.assertIn("Heap allocations: 0", lines)
+
+if __name__ == '__main__':
+    unittest.main()
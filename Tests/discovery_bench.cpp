@@ -0,0 +1,49 @@
+// Benchmarks find_unregistered_pythons over a tree generated by
+// make_discovery_tree.py. discovery.cpp only needs the standard library, so
+// this builds on any platform:
+//
+//   g++ -std=c++17 -O2 -pthread -I.. discovery_bench.cpp ../discovery.cpp -o discovery_bench
+//   python3 make_discovery_tree.py /tmp/tree > /tmp/tree.txt
+//   ./discovery_bench $(sed -n 2p /tmp/tree.txt) $(sed -n 1p /tmp/tree.txt | tr ';' ' ')
+//
+// Exits with a non-zero code if the number of installs found does not match
+// the expected count.
+
+#include "discovery.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "Usage: %s <expected count> <root> [<root> ...]\n", argv[0]);
+        return 2;
+    }
+
+    size_t expected = std::strtoul(argv[1], nullptr, 10);
+    std::vector<std::wstring> roots;
+    for (int i = 2; i < argc; ++i) {
+        std::string root = argv[i];
+        roots.emplace_back(root.begin(), root.end());
+    }
+
+    const int runs = 10;
+    double best = 0, total = 0;
+    size_t found = 0;
+    for (int i = 0; i < runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        auto results = find_unregistered_pythons(roots, 3, false);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        found = results.size();
+        best = i ? std::min(best, elapsed.count()) : elapsed.count();
+        total += elapsed.count();
+    }
+
+    std::printf("found %zu installs (expected %zu)\n", found, expected);
+    std::printf("best %.1f ms, mean %.1f ms over %d runs\n", best, total / runs, runs);
+    return found == expected ? 0 : 1;
+}
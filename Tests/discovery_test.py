@@ -0,0 +1,115 @@
+﻿import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import unittest
+
+class Test_discovery(unittest.TestCase):
+    def _install(self, *parts):
+        path = os.path.join(self.root, *parts)
+        os.makedirs(path)
+        shutil.copy(sys.executable, os.path.join(path, 'python.exe'))
+        return os.path.join(path, 'python.exe')
+
+    def _venv(self, name, version):
+        exe = self._install(name, 'Scripts')
+        with open(os.path.join(self.root, name, 'pyvenv.cfg'), 'w') as f:
+            f.write('home = {}\nversion = {}\n'.format(os.path.dirname(sys.executable), version))
+        return exe
+
+    def _conda(self, name, version):
+        exe = self._install('envs', name)
+        meta = os.path.join(self.root, 'envs', name, 'conda-meta')
+        os.makedirs(meta)
+        for package in ['python-dateutil-2.8.2-pyhd3eb1b0_0', 'python-{}-h6244533_0'.format(version)]:
+            with open(os.path.join(meta, package + '.json'), 'w') as f:
+                f.write('{}')
+        return exe
+
+    def _run(self, args, search_path=None):
+        # Passed as a whole block, since assigning an empty value through
+        # os.environ may remove the variable instead
+        env = dict(os.environ)
+        env["PYLAUNCHER_NOLAUNCH"] = "1"
+        env["PYLAUNCHER_VERBOSE"] = "1"
+        env["PYLAUNCHER_SEARCH_PATH"] = self.root if search_path is None else search_path
+        try:
+            out = subprocess.check_output(
+                [self._python] + args,
+                stderr=subprocess.STDOUT,
+                env=env,
+            )
+        except subprocess.CalledProcessError as ex:
+            out = ex.output
+        res = out.decode('utf-8')
+        print(res)
+        return res.splitlines()
+
+    def __init__(self, methodName = 'runTest'):
+        super().__init__(methodName)
+        self._python = os.path.abspath(os.path.join(os.path.split(__file__)[0], '..', 'Debug', 'python.exe'))
+
+    def setUp(self):
+        self.root = tempfile.mkdtemp()
+
+    def tearDown(self):
+        shutil.rmtree(self.root)
+
+    def test_version_from_directory(self):
+        exe = self._install('Python399')
+        lines = self._run(['3.99'])
+        self.assertEqual("Selected: {}".format(exe), lines[-1])
+
+    def test_version_from_pyvenv_cfg(self):
+        exe = self._venv('env', '3.98.1')
+        lines = self._run(['3.98'])
+        self.assertEqual("Selected: {}".format(exe), lines[-1])
+
+    def test_version_from_nuget_package(self):
+        exe = self._install('python.3.97.0', 'tools')
+        lines = self._run(['3.97'])
+        self.assertEqual("Selected: {}".format(exe), lines[-1])
+
+    def test_conda_env_named_like_a_version(self):
+        exe = self._conda('tf2', '3.96.1')
+        lines = self._run(['3.96'])
+        self.assertEqual("Selected: {}".format(exe), lines[-1])
+        self.assertNotIn(" considering 2", lines)
+
+    def test_conda_env_without_digits(self):
+        exe = self._conda('ml', '3.95.2')
+        lines = self._run(['3.95'])
+        self.assertEqual("Selected: {}".format(exe), lines[-1])
+
+    def test_unversioned_install_is_skipped(self):
+        self._install('envs', 'web2023')
+        lines = self._run(['3.999'])
+        self.assertNotIn(" considering 2.023", lines)
+        self.assertIn("No suitable interpreter found", lines)
+
+    def test_empty_search_path(self):
+        self._install('Python399')
+        lines = self._run(['3.99'], search_path='')
+        self.assertIn("PYLAUNCHER_SEARCH_PATH is empty", lines)
+        self.assertIn("No suitable interpreter found", lines)
+
+    def test_ordering(self):
+        self._install('Python399')
+        self._install('Python3100')
+        self._venv('env4', '4')
+        self._venv('env41', '4.1')
+        # Nothing matches, so every known version is considered in order
+        lines = self._run(['3.999'])
+        considered = [l.strip()[len('considering '):] for l in lines if l.startswith(' considering ')]
+        order = [considered.index(tag) for tag in ['4.1', '4', '3.100', '3.99']]
+        self.assertEqual(sorted(order), order)
+
+    def test_newer_than_registered(self):
+        # Registered interpreters do not hide newer unregistered ones
+        exe = self._venv('env', '3.999')
+        lines = self._run(['3'])
+        self.assertEqual("Selected: {}".format(exe), lines[-1])
+
+if __name__ == '__main__':
+    unittest.main()
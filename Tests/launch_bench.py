@@ -0,0 +1,69 @@
+﻿"""Times repeated launches of the launcher with PYLAUNCHER_NOLAUNCH set.
+
+Each scenario selects the running interpreter, which must be registered, so
+the timings cover parsing, the registry search and building the command line.
+The filesystem walk is disabled (see discovery_bench.cpp for that).
+
+Usage: launch_bench.py [Debug|Release] [runs]
+
+Prints the best and median time of each scenario in milliseconds.
+"""
+
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+def time_launch(python, args, env, runs):
+    times = []
+    for _ in range(runs):
+        start = time.perf_counter()
+        subprocess.check_call([python] + args, stdout=subprocess.DEVNULL, env=env)
+        times.append((time.perf_counter() - start) * 1000)
+    return min(times), statistics.median(times)
+
+def main():
+    config = sys.argv[1] if len(sys.argv) > 1 else 'Release'
+    runs = int(sys.argv[2]) if len(sys.argv) > 2 else 200
+    python = os.path.abspath(os.path.join(os.path.split(__file__)[0], '..', config, 'python.exe'))
+    version = "{0[0]}.{0[1]}{1}".format(sys.version_info, '-32' if sys.maxsize < 2**32 else '')
+
+    tmp = tempfile.mkdtemp()
+    script = os.path.join(tmp, 'bench.py')
+    with open(script, 'w', encoding='utf-8') as f:
+        f.write('#! /usr/bin/env python' + version + ' -u\n')
+    response = os.path.join(tmp, 'bench.rsp')
+    with open(response, 'w', encoding='utf-8') as f:
+        f.write(version + '\n-u\n')
+    # Too long to pass directly, so the arguments go through a response file
+    # and the launcher takes its spill path
+    long_response = os.path.join(tmp, 'long.rsp')
+    with open(long_response, 'w', encoding='utf-8') as f:
+        f.write('\n'.join([version, script] + ['x' * 50] * 700))
+
+    scenarios = [
+        ('version argument', [version, '-c', 'pass', 'an argument']),
+        ('shebang', [script, 'an argument']),
+        ('response file', ['@' + response, '-c', 'pass']),
+        ('long command line', ['@' + long_response]),
+    ]
+
+    # Passed as a whole block, since assigning an empty value through
+    # os.environ may remove the variable instead
+    env = dict(os.environ)
+    env['PYLAUNCHER_NOLAUNCH'] = '1'
+    env['PYLAUNCHER_SEARCH_PATH'] = ''
+    try:
+        for name, args in scenarios:
+            best, median = time_launch(python, args, env, runs)
+            print('{:<20} best {:7.2f} ms  median {:7.2f} ms'.format(name, best, median))
+    finally:
+        os.remove(script)
+        os.remove(response)
+        os.remove(long_response)
+        os.rmdir(tmp)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,77 @@
+﻿"""Generates a directory tree for benchmarking discovery.cpp.
+
+The tree contains installs in each layout the walker recognizes, conda
+environments with names that must not be mistaken for versions, and many
+directories that contain no interpreter at all.
+
+Usage: make_discovery_tree.py <output dir> [groups]
+
+Prints the search roots (separated by ';') and the number of installs that
+should be found.
+"""
+
+import os
+import random
+import sys
+
+def touch(*parts):
+    path = os.path.join(*parts)
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    open(path, 'wb').close()
+
+def make_install(path, version, lib_dirs=20):
+    touch(path, 'python.exe')
+    touch(path, 'pythonw.exe')
+    touch(path, 'python3.dll')
+    for i in range(lib_dirs):
+        os.makedirs(os.path.join(path, 'Lib', 'site-packages', 'pkg{}'.format(i), 'sub'), exist_ok=True)
+
+def main():
+    out = sys.argv[1]
+    groups = int(sys.argv[2]) if len(sys.argv) > 2 else 20
+    rnd = random.Random(1)
+    programs = os.path.join(out, 'Programs', 'Python')
+    pyenv = os.path.join(out, 'pyenv', 'versions')
+    conda = os.path.join(out, 'conda', 'envs')
+    nuget = os.path.join(out, 'nuget')
+    other = os.path.join(out, 'other')
+    found = 0
+
+    for g in range(groups):
+        minor = 5 + g % 8
+        make_install(os.path.join(programs, 'Python3{}-{}'.format(minor, g)), minor)
+        touch(programs, 'Python3{}-{}'.format(minor, g), 'python3{}.dll'.format(minor))
+        found += 1
+
+        path = os.path.join(pyenv, '3.{}.{}'.format(minor, g))
+        make_install(path, minor)
+        touch(path, 'python3{}.zip'.format(minor))
+        found += 1
+
+        for name in ['tf2', 'ml', 'web2023', 'env{}'.format(g)]:
+            path = os.path.join(conda, '{}-{}'.format(name, g))
+            make_install(path, minor)
+            touch(path, 'conda-meta', 'python-3.{}.{}-h{}_0.json'.format(minor, g, rnd.randrange(1000)))
+            touch(path, 'conda-meta', 'python-dateutil-2.8.2-pyhd3eb1b0_0.json')
+            found += 1
+
+        path = os.path.join(other, 'venv{}'.format(g))
+        touch(path, 'Scripts', 'python.exe')
+        with open(os.path.join(path, 'pyvenv.cfg'), 'w') as f:
+            f.write('home = C:\\Python3{0}\nversion = 3.{0}.1\n'.format(minor))
+        found += 1
+
+        make_install(os.path.join(nuget, 'python.3.{}.{}'.format(minor, g), 'tools'), minor)
+        found += 1
+
+        # An interpreter with no version information is skipped
+        make_install(os.path.join(other, 'unknown{}'.format(g)), minor)
+
+        for i in range(100):
+            os.makedirs(os.path.join(other, 'project{}'.format(g), 'src{}'.format(i), 'module'), exist_ok=True)
+
+    print(';'.join([programs, pyenv, conda, nuget, other]))
+    print(found)
+
+if __name__ == '__main__':
+    main()
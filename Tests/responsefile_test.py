@@ -0,0 +1,124 @@
+﻿import os
+import subprocess
+import sys
+import tempfile
+import unittest
+
+class Test_responsefile(unittest.TestCase):
+    def _write(self, lines):
+        fd, fn = tempfile.mkstemp(suffix='.rsp')
+        with open(fd, 'w', encoding='utf-8') as f:
+            f.write('\n'.join(lines))
+        self.addCleanup(os.unlink, fn)
+        return fn
+
+    def _run(self, args, launch=False):
+        env = dict(os.environ)
+        env["PYLAUNCHER_VERBOSE"] = "1"
+        if not launch:
+            env["PYLAUNCHER_NOLAUNCH"] = "1"
+        out = subprocess.check_output(
+            [self._python] + args,
+            stderr=subprocess.STDOUT,
+            env=env,
+        )
+        res = out.decode('utf-8')
+        return res
+
+    def __init__(self, methodName = 'runTest'):
+        super().__init__(methodName)
+        self._python = os.path.abspath(os.path.join(os.path.split(__file__)[0], '..', 'Debug', 'python.exe'))
+        self.version = "{0[0]}.{0[1]}{1}".format(sys.version_info, '-32' if sys.maxsize < 2**32 else '')
+
+    def test_expand(self):
+        rsp = self._write([self.version + " -u", "-c", '"import sys"'])
+        last_line = self._run(["@" + rsp]).splitlines()[-1]
+        self.assertEqual(
+            "Selected: {} -u -c \"import sys\"".format(sys.executable),
+            last_line
+        )
+
+    def test_script_args_not_expanded(self):
+        rsp = self._write(["-u"])
+        last_line = self._run([self.version, "script.py", "@" + rsp]).splitlines()[-1]
+        self.assertEqual(
+            "Selected: {} script.py @{}".format(sys.executable, rsp),
+            last_line
+        )
+
+    def test_utf8_without_bom(self):
+        # The script is only found if its name is decoded correctly, which is
+        # checked through the shebang so that only ASCII is compared
+        script = os.path.join(tempfile.mkdtemp(), "Pyth\u00f6n.py")
+        with open(script, 'w', encoding='utf-8') as f:
+            f.write("#! /usr/bin/env python" + self.version + "\n")
+        self.addCleanup(os.rmdir, os.path.dirname(script))
+        self.addCleanup(os.unlink, script)
+        rsp = self._write(['"{}"'.format(script)])
+        lines = self._run(["@" + rsp]).splitlines()
+        self.assertIn("Found version '{}' in shebang".format(self.version), lines)
+
+    def test_option_values_skipped(self):
+        rsp = self._write(["-u"])
+        last_line = self._run([self.version, "-W", "ignore", "@" + rsp, "script.py"]).splitlines()[-1]
+        self.assertEqual(
+            "Selected: {} -W ignore -u script.py".format(sys.executable),
+            last_line
+        )
+
+    def test_not_expanded_after_code(self):
+        rsp = self._write(["-u"])
+        last_line = self._run([self.version, "-c", "@" + rsp]).splitlines()[-1]
+        self.assertEqual(
+            "Selected: {} -c @{}".format(sys.executable, rsp),
+            last_line
+        )
+
+    def test_module_is_not_read_for_shebang(self):
+        cwd = tempfile.mkdtemp()
+        with open(os.path.join(cwd, "pip"), 'w') as f:
+            f.write("#! /usr/bin/env python" + self.version + "\n")
+        self.addCleanup(os.rmdir, cwd)
+        self.addCleanup(os.unlink, os.path.join(cwd, "pip"))
+        rsp = self._write(["-m", "pip"])
+        old_cwd = os.getcwd()
+        os.chdir(cwd)
+        try:
+            lines = self._run(["@" + rsp]).splitlines()
+        finally:
+            os.chdir(old_cwd)
+        self.assertNotIn("Reading shebang from pip", lines)
+
+    def test_spill_options_too_long(self):
+        # Only arguments after the script are spilled, so a line that is too
+        # long because of interpreter options is still an error
+        rsp = self._write([self.version] + ["-X", "x" * 100] * 330 + ["script.py", "argument"])
+        with self.assertRaises(subprocess.CalledProcessError):
+            self._run(["@" + rsp], launch=True)
+
+    def test_spill_not_written_without_launch(self):
+        args = ["argument_{:05}".format(i) for i in range(5000)]
+        rsp = self._write([self.version, "script.py"] + args)
+        lines = self._run(["@" + rsp]).splitlines()
+        quotes = 2 if " " in sys.executable else 0
+        length = len(sys.executable) + quotes + len(" script.py") + sum(len(a) + 1 for a in args)
+        self.assertIn(
+            "Command line is {} characters, so arguments would be passed in a response file".format(length),
+            lines
+        )
+
+    def test_spill(self):
+        args = ["argument_{:05}".format(i) for i in range(5000)]
+        rsp = self._write([self.version, "-X", "utf8", "script.py"] + args)
+        lines = self._run(["@" + rsp], launch=True).splitlines()
+        prefix = "Selected: {} -X utf8 script.py @".format(sys.executable)
+        selected = [l for l in lines if l.startswith("Selected: ")]
+        self.assertEqual(1, len(selected), lines)
+        self.assertTrue(selected[0].startswith(prefix), selected[0])
+        self.assertIn("Wrote 5000 arguments to {}".format(selected[0][len(prefix):]), lines)
+
+        # The response file is deleted when the launcher exits
+        self.assertFalse(os.path.exists(selected[0][len(prefix):]))
+
+if __name__ == '__main__':
+    unittest.main()
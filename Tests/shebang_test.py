@@ -25,7 +25,7 @@ class Test_shebang(unittest.TestCase):
         finally:
             del os.environ["PYLAUNCHER_NOLAUNCH"]
             del os.environ["PYLAUNCHER_VERBOSE"]
-        res = out.decode('utf-8')
+        res = out.decode('utf-8', 'replace')
         print(res)
         return res
 
@@ -85,5 +85,52 @@ class Test_shebang(unittest.TestCase):
                 last_line
             )
 
+    def test_common_shebangs(self):
+        templates = [
+            "#!python{}",
+            "#! python{}",
+            "#!/usr/bin/python{}",
+            "#!/usr/bin/env python{}",
+            "#! /usr/bin/env  python{}",
+        ]
+        for template in templates:
+            for encoding in ['ascii', 'utf-8-sig', 'utf-16']:
+                with self.subTest(template=template, encoding=encoding):
+                    with self._write("common.py", template.format(self.version), encoding) as f:
+                        lines = self._run([f.path]).splitlines()
+                        self.assertIn("Found version '{}' in shebang".format(self.version), lines)
+                        self.assertEqual(
+                            "Selected: {} {}".format(sys.executable, f.path),
+                            lines[-1]
+                        )
+
+    def _check_cmdline_shebang(self, name, cmd, encoding):
+        with self._write(name, "#! " + cmd + " -X:Frames", encoding) as f:
+            out = self._run([f.path])
+            last_line = out.splitlines()[-1]
+            # Non-ASCII characters may not survive the console, so only
+            # compare the parts that always do
+            prefix, _, suffix = "Selected: {} -X:Frames {}".format(cmd, f.path).partition("\u00f6")
+            self.assertTrue(last_line.startswith(prefix), last_line)
+            self.assertTrue(last_line.endswith(suffix), last_line)
+
+    def test_non_ascii_utf8_shebang(self):
+        cmd = '"C:\\Program Files\\Pyth\u00f6n\\python.exe"'
+        self._check_cmdline_shebang("nonascii-utf8.py", cmd, 'utf-8-sig')
+
+    def test_non_ascii_ansi_shebang(self):
+        cmd = '"C:\\Program Files\\Pyth\u00f6n\\python.exe"'
+        try:
+            cmd.encode('mbcs', 'strict')
+        except UnicodeEncodeError:
+            self.skipTest("active code page cannot encode the test path")
+        self._check_cmdline_shebang("nonascii-ansi.py", cmd, 'mbcs')
+
+    def test_long_non_ascii_shebang(self):
+        # Longer than the fixed 1023 character buffer that used to be used. The
+        # path needs a space so that the launcher quotes it again.
+        cmd = '"C:\\Program Files\\{}\\Pyth\u00f6n\\python.exe"'.format('x' * 1100)
+        self._check_cmdline_shebang("nonascii-long.py", cmd, 'utf-8-sig')
+
 if __name__ == '__main__':
     unittest.main()
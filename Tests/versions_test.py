@@ -0,0 +1,50 @@
+﻿import os
+import subprocess
+import sys
+import unittest
+import winreg
+
+PYTHONCORE = r"Software\Python\PythonCore"
+
+class Test_versions(unittest.TestCase):
+    def _register(self, tag):
+        # Every tag points at the running interpreter, since only the tag
+        # affects ordering
+        key = winreg.CreateKey(winreg.HKEY_CURRENT_USER, PYTHONCORE + "\\" + tag + r"\InstallPath")
+        with key:
+            winreg.SetValue(key, "", winreg.REG_SZ, os.path.dirname(sys.executable))
+        self.addCleanup(winreg.DeleteKey, winreg.HKEY_CURRENT_USER, PYTHONCORE + "\\" + tag)
+        self.addCleanup(winreg.DeleteKey, winreg.HKEY_CURRENT_USER, PYTHONCORE + "\\" + tag + r"\InstallPath")
+
+    def _run(self, args):
+        env = dict(os.environ)
+        env["PYLAUNCHER_NOLAUNCH"] = "1"
+        env["PYLAUNCHER_VERBOSE"] = "1"
+        env["PYLAUNCHER_SEARCH_PATH"] = ""
+        try:
+            out = subprocess.check_output(
+                [self._python] + args,
+                stderr=subprocess.STDOUT,
+                env=env,
+            )
+        except subprocess.CalledProcessError as ex:
+            out = ex.output
+        res = out.decode('utf-8')
+        print(res)
+        return res.splitlines()
+
+    def __init__(self, methodName = 'runTest'):
+        super().__init__(methodName)
+        self._python = os.path.abspath(os.path.join(os.path.split(__file__)[0], '..', 'Debug', 'python.exe'))
+
+    def test_ordering(self):
+        for tag in ['3.99', '4', '3.100', '4.1']:
+            self._register(tag)
+        # Nothing matches, so every known version is considered in order
+        lines = self._run(['3.999'])
+        considered = [l.strip()[len('considering '):] for l in lines if l.startswith(' considering ')]
+        order = [considered.index(tag) for tag in ['4.1', '4', '3.100', '3.99']]
+        self.assertEqual(sorted(order), order)
+
+if __name__ == '__main__':
+    unittest.main()
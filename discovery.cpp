@@ -0,0 +1,256 @@
+#include "discovery.h"
+
+// This file only uses the standard library, so it does not use the
+// precompiled header and can be built and benchmarked on any platform.
+#include <algorithm>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+namespace fs = std::filesystem;
+using std::vector;
+using std::wstring;
+
+static bool is_digits(const wstring &s) {
+    return !s.empty() && std::all_of(s.cbegin(), s.cend(), [](wchar_t c) {
+        return c >= L'0' && c <= L'9';
+    });
+}
+
+static wstring ascii_lower(wstring s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](wchar_t c) {
+        return (c >= L'A' && c <= L'Z') ? c - L'A' + L'a' : c;
+    });
+    return s;
+}
+
+// Converts the digits in names like python38.dll or Python310 into a '3.8' or
+// '3.10' tag. A single digit is rejected, since python3.dll is in every
+// install regardless of version.
+static bool tag_from_digits(const wstring &digits, wstring *tag) {
+    if (digits.length() < 2 || (digits[0] != L'2' && digits[0] != L'3') || !is_digits(digits)) {
+        return false;
+    }
+    *tag = digits.substr(0, 1) + L"." + digits.substr(1);
+    return true;
+}
+
+// Returns the major.minor part of a version such as '3.8.2' or '3.11.4.final.0'
+static bool tag_from_version(const wstring &version, wstring *tag) {
+    auto dot = version.find(L'.');
+    if (dot == wstring::npos || !is_digits(version.substr(0, dot))) {
+        return false;
+    }
+    auto end = version.find_first_not_of(L"0123456789", dot + 1);
+    if (end == dot + 1) {
+        return false;
+    }
+    *tag = version.substr(0, end);
+    return true;
+}
+
+// Reads the 'version' (or newer 'version_info') key from a pyvenv.cfg and
+// returns it as a major.minor tag.
+static bool read_pyvenv_version(const fs::path &cfg, wstring *tag) {
+    std::ifstream f(cfg);
+    std::string line;
+    while (std::getline(f, line)) {
+        auto eq = line.find('=');
+        if (eq == std::string::npos) {
+            continue;
+        }
+        auto key = line.substr(0, line.find_last_not_of(" \t", eq - 1) + 1);
+        if (key != "version" && key != "version_info") {
+            continue;
+        }
+        auto start = line.find_first_not_of(" \t", eq + 1);
+        if (start == std::string::npos) {
+            return false;
+        }
+        auto end = line.find('.', start);
+        if (end != std::string::npos) {
+            end = line.find_first_not_of("0123456789", end + 1);
+        }
+        if (end == std::string::npos) {
+            end = line.find_last_not_of(" \t\r") + 1;
+        }
+        tag->assign(line.cbegin() + start, line.cbegin() + end);
+        return !tag->empty();
+    }
+    return false;
+}
+
+// Conda records each installed package as conda-meta\{name}-{version}-{build}.json
+static bool read_conda_version(const fs::path &meta, wstring *tag) {
+    std::error_code ec;
+    for (fs::directory_iterator it(meta, ec), end; !ec && it != end; it.increment(ec)) {
+        auto name = ascii_lower(it->path().filename().wstring());
+        if (name.compare(0, 7, L"python-") != 0 || name.length() < 8 || name[7] < L'0' || name[7] > L'9') {
+            continue;
+        }
+        auto end_of_version = name.find(L'-', 7);
+        if (tag_from_version(name.substr(7, end_of_version - 7), tag)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The version must come from something the install itself records. Names
+// chosen by users, such as conda environment names, are never used, with the
+// exception of the Python3X directories created by the installer and NuGet's
+// {name}.{version}\tools layout.
+static bool infer_tag(const fs::path &dir, bool has_cfg, bool has_conda_meta, const wstring &file_tag, wstring *tag) {
+    if (has_cfg && read_pyvenv_version(dir / L"pyvenv.cfg", tag)) {
+        return true;
+    }
+    if (has_conda_meta && read_conda_version(dir / L"conda-meta", tag)) {
+        return true;
+    }
+    if (!file_tag.empty()) {
+        *tag = file_tag;
+        return true;
+    }
+
+    auto name = ascii_lower(dir.filename().wstring());
+    if (name.compare(0, 6, L"python") == 0) {
+        return tag_from_digits(name.substr(6), tag);
+    }
+    if (name != L"tools") {
+        return false;
+    }
+
+    // The version starts at the first '.' followed by a digit
+    auto parent = ascii_lower(dir.parent_path().filename().wstring());
+    for (auto dot = parent.find(L'.'); dot != wstring::npos; dot = parent.find(L'.', dot + 1)) {
+        if (dot + 1 < parent.length() && parent[dot + 1] >= L'0' && parent[dot + 1] <= L'9') {
+            return tag_from_version(parent.substr(dot + 1), tag);
+        }
+    }
+    return false;
+}
+
+// Checks a single directory for an interpreter from one pass over its
+// entries, collecting its subdirectories for the walker at the same time.
+// Virtual environments keep their interpreter in the Scripts subdirectory.
+static bool inspect_dir(const fs::path &dir, const wstring &exe_name, discovered_python *result, vector<fs::path> &subdirs, bool *is_install) {
+    bool has_exe = false, has_cfg = false, has_scripts = false, has_conda_meta = false;
+    wstring file_tag;
+
+    std::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        std::error_code ec2;
+        auto name = ascii_lower(it->path().filename().wstring());
+
+        if (it->is_directory(ec2)) {
+            if (!it->is_symlink(ec2)) {
+                subdirs.push_back(it->path());
+            }
+            has_scripts |= (name == L"scripts");
+            has_conda_meta |= (name == L"conda-meta");
+        } else if (name == exe_name) {
+            has_exe = true;
+        } else if (name == L"pyvenv.cfg") {
+            has_cfg = true;
+        } else if (file_tag.empty() && name.length() > 10 && name.compare(0, 6, L"python") == 0) {
+            // python38.dll and the embeddable python38.zip, or versioned
+            // copies of the interpreter such as python3.8.exe
+            auto ext = name.substr(name.length() - 4);
+            auto stem = name.substr(6, name.length() - 10);
+            if (ext == L".dll" || ext == L".zip") {
+                tag_from_digits(stem, &file_tag);
+            } else if (ext == L".exe") {
+                tag_from_version(stem, &file_tag);
+            }
+        }
+    }
+
+    *is_install = has_exe;
+    auto install_path = dir;
+    if (!has_exe) {
+        if (!has_cfg || !has_scripts || !fs::is_regular_file(dir / L"Scripts" / exe_name, ec)) {
+            return false;
+        }
+        *is_install = true;
+        install_path = dir / L"Scripts";
+    }
+
+    wstring tag;
+    if (!infer_tag(dir, has_cfg, has_conda_meta, file_tag, &tag)) {
+        return false;
+    }
+
+    result->tag = tag;
+    result->install_path = install_path.wstring();
+    result->exe_name = exe_name;
+    return true;
+}
+
+vector<discovered_python> find_unregistered_pythons(const vector<wstring> &roots, int max_depth, bool preferW) {
+    const wstring exe_name = preferW ? L"pythonw.exe" : L"python.exe";
+
+    std::mutex lock;
+    std::condition_variable wake;
+    vector<std::pair<fs::path, int>> pending;
+    size_t busy = 0;
+    vector<discovered_python> results;
+
+    for (const auto &root : roots) {
+        pending.emplace_back(root, 0);
+    }
+
+    auto worker = [&]() {
+        vector<fs::path> subdirs;
+        for (;;) {
+            std::pair<fs::path, int> item;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [&] { return !pending.empty() || busy == 0; });
+                if (pending.empty()) {
+                    return;
+                }
+                item = std::move(pending.back());
+                pending.pop_back();
+                ++busy;
+            }
+
+            discovered_python python;
+            subdirs.clear();
+            bool is_install;
+            bool found = inspect_dir(item.first, exe_name, &python, subdirs, &is_install);
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (found) {
+                    results.push_back(std::move(python));
+                } else if (!is_install && item.second < max_depth) {
+                    // Installs are not expected to contain further installs,
+                    // and their Lib directories are the largest part of the tree.
+                    for (auto &d : subdirs) {
+                        pending.emplace_back(std::move(d), item.second + 1);
+                    }
+                }
+                --busy;
+            }
+            wake.notify_all();
+        }
+    };
+
+    vector<std::thread> threads;
+    // Most of the time is spent waiting on directory reads, so use a few
+    // threads even on single core machines.
+    auto thread_count = std::clamp(std::thread::hardware_concurrency(), 4u, 8u);
+    for (unsigned int i = 0; i < thread_count; ++i) {
+        threads.emplace_back(worker);
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    std::sort(results.begin(), results.end(), [](const discovered_python &x, const discovered_python &y) {
+        return x.install_path < y.install_path;
+    });
+    return results;
+}
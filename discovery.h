@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct discovered_python {
+    std::wstring tag;
+    std::wstring install_path;
+    std::wstring exe_name;
+};
+
+// Walks each root with a pool of worker threads looking for interpreters that
+// were never registered, such as embeddable, nuget, conda and pyenv-win
+// installs. Directories deeper than max_depth below a root are not visited.
+// Results are sorted by install path so that callers see a stable order.
+std::vector<discovered_python> find_unregistered_pythons(
+    const std::vector<std::wstring> &roots,
+    int max_depth,
+    bool preferW
+);
@@ -1,8 +1,8 @@
 #include "stdafx.h"
 
-using std::wstring;
+using std::wstring_view;
 
-void print_error(DWORD err, const wstring &action) {
+void print_error(DWORD err, wstring_view action) {
     wchar_t buffer[4096];
     if (FormatMessageW(
         FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
@@ -17,5 +17,5 @@ void print_error(DWORD err, const wstring &action) {
         return;
     }
 
-    wprintf_s(L"Error while %s: %s\n", action.c_str(), buffer);
+    wprintf_s(L"Error while %.*s: %s\n", static_cast<int>(action.length()), action.data(), buffer);
 }
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <string>
+#include <string_view>
 #include <windows.h>
 
-void print_error(DWORD err, const std::wstring &action);
+void print_error(DWORD err, std::wstring_view action);
@@ -2,10 +2,9 @@
 #include "parsing.h"
 #include "errors.h"
 
-using std::wstring;
-using std::vector;
-using std::make_unique;
-using std::unique_ptr;
+using std::pmr::wstring;
+using std::pmr::vector;
+using std::wstring_view;
 
 extern bool verbose;
 
@@ -13,7 +12,7 @@ bool extract_version(vector<wstring> &args, wstring *version_tag);
 
 // If the first part of the shebang line matches any of these completely, it
 // will be ignored. If its prefix matches, it will be trimmed.
-const wstring SHEBANG_TEMPLATES[] = {
+const wstring_view SHEBANG_TEMPLATES[] = {
     L"/usr/bin/env",
     L"/usr/bin/"
 };
@@ -43,13 +42,12 @@ iter find_next_arg(iter begin, iter end) {
     return end;
 }
 
-vector<wstring> split_args(const wstring& str) {
+void split_args(wstring_view str, vector<wstring> &res) {
     auto start = str.cbegin();
     decltype(start) nextStart;
-    vector<wstring> res;
 
     if (verbose) {
-        wprintf_s(L"Parsing arguments from %ls\n", str.c_str());
+        wprintf_s(L"Parsing arguments from %.*ls\n", static_cast<int>(str.length()), str.data());
     }
 
     while ((nextStart = find_next_arg(start, str.cend())) != str.cend()) {
@@ -82,7 +80,6 @@ vector<wstring> split_args(const wstring& str) {
     if (verbose) {
         wprintf_s(L"  \"%ls\"\nEnd of arguments\n", res.back().c_str());
     }
-    return res;
 }
 
 template<typename iter>
@@ -98,15 +95,75 @@ iter skip_shebang(iter begin, const iter& end) {
     return begin;
 }
 
-bool equal_ignore_case(const wstring& left, const wstring& right) {
+template<typename iter>
+bool is_ascii(iter begin, iter end) {
+    return std::all_of(begin, end, [](auto c) {
+        return static_cast<unsigned int>(c) < 0x80;
+    });
+}
+
+wchar_t ascii_lower(wchar_t c) {
+    return (c >= L'A' && c <= L'Z') ? c - L'A' + L'a' : c;
+}
+
+bool equal_ignore_case(wstring_view left, wstring_view right) {
+    // Everything the launcher compares itself is ASCII, so only involve the
+    // locale when either side actually contains other characters.
+    if (is_ascii(left.cbegin(), left.cend()) && is_ascii(right.cbegin(), right.cend())) {
+        return std::equal(left.cbegin(), left.cend(), right.cbegin(), right.cend(), [](wchar_t x, wchar_t y) {
+            return ascii_lower(x) == ascii_lower(y);
+        });
+    }
+
     return CSTR_EQUAL == ::CompareStringW(
         LOCALE_USER_DEFAULT,
         NORM_IGNORECASE,
-        left.c_str(), -1,
-        right.c_str(), -1);
+        left.data(), static_cast<int>(left.length()),
+        right.data(), static_cast<int>(right.length()));
+}
+
+bool decode(const char *buffer, size_t length, UINT codepage, wstring *text) {
+    // Most shebangs and response files are plain ASCII, which is identical in
+    // every code page
+    if (is_ascii(buffer, buffer + length)) {
+        text->assign(buffer, buffer + length);
+        return true;
+    }
+
+    int cch = MultiByteToWideChar(codepage, 0, buffer, static_cast<int>(length), nullptr, 0);
+    text->resize(cch);
+    if (!cch || !MultiByteToWideChar(codepage, 0, buffer, static_cast<int>(length), text->data(), cch)) {
+        auto err = GetLastError();
+        print_error(err, L"decoding text");
+        return false;
+    }
+    return true;
+}
+
+// Decodes text that may or may not be UTF-8. Invalid sequences fail without
+// reporting an error, so that the caller can fall back to another code page.
+bool decode_strict_utf8(const char *buffer, size_t length, wstring *text) {
+    if (is_ascii(buffer, buffer + length)) {
+        text->assign(buffer, buffer + length);
+        return true;
+    }
+
+    int cch = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, buffer, static_cast<int>(length), nullptr, 0);
+    if (!cch) {
+        return false;
+    }
+    text->resize(cch);
+    return MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, buffer, static_cast<int>(length), text->data(), cch) != 0;
+}
+
+bool decode_first_line(const char *buffer, size_t length, UINT codepage, wstring *line) {
+    auto end = std::find_if(buffer, buffer + length, [](char c) {
+        return c == '\n' || c == '\0';
+    });
+    return decode(buffer, end - buffer, codepage, line);
 }
 
-unique_ptr<wstring> read_first_line(const wstring &filename) {
+bool read_first_line(const wstring &filename, wstring *line) {
     DWORD err;
     auto hFile = CreateFileW(
         filename.c_str(),
@@ -118,10 +175,10 @@ unique_ptr<wstring> read_first_line(const wstring &filename) {
     if (hFile == INVALID_HANDLE_VALUE) {
         err = GetLastError();
         if (err = ERROR_FILE_NOT_FOUND) {
-            return nullptr;
+            return false;
         }
         print_error(err, L"opening file to read first line");
-        return nullptr;
+        return false;
     }
 
     char buffer[2048] = { 0 };
@@ -132,33 +189,197 @@ unique_ptr<wstring> read_first_line(const wstring &filename) {
 
     if (!success) {
         print_error(err, L"reading first line of file");
-        return nullptr;
+        return false;
     }
     if (bytesRead < 3) {
         if (verbose) {
             wprintf_s(L"Failed to read enough characters");
         }
-        return nullptr;
+        return false;
     }
 
     if (bytesRead > 2 && buffer[0] == '\xFF' && buffer[1] == '\xFE') {
-        return make_unique<wstring>(reinterpret_cast<wchar_t*>(buffer + 2));
+        line->assign(reinterpret_cast<wchar_t*>(buffer + 2));
+        return true;
 
     } else if (bytesRead > 2 && !buffer[0] && buffer[1]) {
-        return make_unique<wstring>(reinterpret_cast<wchar_t*>(buffer));
+        line->assign(reinterpret_cast<wchar_t*>(buffer));
+        return true;
 
     } else if (bytesRead > 3 && buffer[0] == '\xEF' && buffer[1] == '\xBB' && buffer[2] == '\xBF') {
-        wchar_t wbuffer[1024];
-        MultiByteToWideChar(CP_UTF8, 0, &buffer[3], -1, wbuffer, 1023);
-        return make_unique<wstring>(wbuffer);
+        return decode_first_line(&buffer[3], bytesRead - 3, CP_UTF8, line);
 
     } else if (bytesRead > 0) {
-        wchar_t wbuffer[1024];
-        MultiByteToWideChar(CP_ACP, 0, buffer, -1, wbuffer, 1023);
-        return make_unique<wstring>(wbuffer);
+        return decode_first_line(buffer, bytesRead, CP_ACP, line);
 
     } else {
-        return nullptr;
+        return false;
+    }
+}
+
+bool read_response_file(const wchar_t *filename, wstring *contents) {
+    DWORD err;
+    auto hFile = CreateFileW(
+        filename,
+        GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        err = GetLastError();
+        if (err != ERROR_FILE_NOT_FOUND && err != ERROR_PATH_NOT_FOUND) {
+            print_error(err, L"opening response file");
+        }
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    std::pmr::string buffer(contents->get_allocator());
+    DWORD bytesRead = 0;
+    BOOL success = GetFileSizeEx(hFile, &size) && size.QuadPart < 0x7FFFFFFF;
+    if (success) {
+        buffer.resize(static_cast<size_t>(size.QuadPart));
+        success = ReadFile(hFile, buffer.data(), static_cast<DWORD>(buffer.size()), &bytesRead, nullptr);
+    }
+    err = GetLastError();
+    CloseHandle(hFile);
+
+    if (!success) {
+        print_error(err, L"reading response file");
+        return false;
+    }
+    buffer.resize(bytesRead);
+
+    if (bytesRead >= 2 && buffer[0] == '\xFF' && buffer[1] == '\xFE') {
+        contents->assign(reinterpret_cast<const wchar_t*>(buffer.data() + 2), (bytesRead - 2) / sizeof(wchar_t));
+    } else if (bytesRead >= 3 && buffer[0] == '\xEF' && buffer[1] == '\xBB' && buffer[2] == '\xBF') {
+        if (!decode(buffer.data() + 3, bytesRead - 3, CP_UTF8, contents)) {
+            return false;
+        }
+    } else if (!decode_strict_utf8(buffer.data(), bytesRead, contents) &&
+        !decode(buffer.data(), bytesRead, CP_ACP, contents)) {
+        // Files without a BOM are usually UTF-8, including those written by
+        // the launcher itself, so the ANSI code page is only a fallback
+        return false;
+    }
+
+    // Arguments may be split across lines
+    std::replace_if(contents->begin(), contents->end(), [](wchar_t c) {
+        return c == L'\r' || c == L'\n' || c == L'\t';
+    }, L' ');
+    return true;
+}
+
+// Returns the index after the option at args[i] and any value it takes, or i
+// if args[i] is not an option. Options are grouped the way the interpreter
+// parses them, so '-uX utf8' skips two arguments and '-Xutf8' one. For '-c',
+// '-m' and '--', *ends is set and the returned index is the script, code or
+// module name, even when it starts with '-'.
+static size_t skip_option(const vector<wstring> &args, size_t i, bool *ends) {
+    *ends = false;
+    const auto &a = args[i];
+    if (a.length() < 2 || (a[0] != L'-' && a[0] != L'@')) {
+        return i;
+    }
+    if (a[0] == L'@') {
+        return i + 1;
+    }
+    if (a[1] == L'-') {
+        if (a.length() == 2) {
+            *ends = true;
+            return i + 1;
+        }
+        return i + (a == L"--check-hash-based-pycs" ? 2 : 1);
+    }
+
+    for (size_t c = 1; c < a.length(); ++c) {
+        switch (a[c]) {
+        case L'c':
+        case L'm':
+            *ends = true;
+            return c + 1 < a.length() ? i : i + 1;
+        case L'W':
+        case L'X':
+            return c + 1 < a.length() ? i + 1 : i + 2;
+        }
+    }
+    return i + 1;
+}
+
+size_t find_script(const vector<wstring> &args, size_t first, bool *is_code) {
+    *is_code = false;
+    auto i = first;
+    while (i < args.size()) {
+        bool ends;
+        auto next = skip_option(args, i, &ends);
+        if (ends || next == i) {
+            *is_code = ends && args[i] != L"--";
+            return std::min(next, args.size());
+        }
+        i = next;
+    }
+    return args.size();
+}
+
+// Replaces '@file' arguments with the arguments read from the file. Only
+// arguments ahead of the script are expanded, since anything after it belongs
+// to the script, which may handle response files itself. Response files are
+// not expanded recursively.
+void expand_response_files(vector<wstring> &args) {
+    // Returns the index of the next launcher or interpreter option, or i once
+    // nothing more belongs to the launcher
+    auto next_option = [&](size_t i) {
+        if (i == 1 && !args[i].empty() && (args[i][0] == L'2' || args[i][0] == L'3')) {
+            return i + 1;
+        }
+        bool ends;
+        auto next = skip_option(args, i, &ends);
+        return ends ? i : next;
+    };
+
+    size_t i = 1;
+    while (i < args.size()) {
+        auto next = next_option(i);
+        if (next == i) {
+            return;
+        }
+        if (args[i][0] != L'@') {
+            i = next;
+            continue;
+        }
+
+        wstring contents(args.get_allocator());
+        if (!read_response_file(args[i].c_str() + 1, &contents)) {
+            if (verbose) {
+                wprintf_s(L"Cannot read response file \"%ls\"\n", args[i].c_str() + 1);
+            }
+            i = next;
+            continue;
+        }
+        if (verbose) {
+            wprintf_s(L"Expanding response file \"%ls\"\n", args[i].c_str() + 1);
+        }
+
+        auto first = contents.find_first_not_of(L' ');
+        auto last = contents.find_last_not_of(L' ');
+        size_t added = 0;
+        if (first != wstring::npos) {
+            // Split straight onto the end and rotate into place, rather than
+            // building a separate list to insert
+            auto before = args.size();
+            split_args({ contents.data() + first, last - first + 1 }, args);
+            added = args.size() - before;
+            std::rotate(args.begin() + i + 1, args.begin() + before, args.end());
+        }
+        args.erase(args.begin() + i);
+
+        for (auto end = i + added; i < end; i = next) {
+            next = next_option(i);
+            if (next == i) {
+                return;
+            }
+        }
     }
 }
 
@@ -167,14 +388,13 @@ bool parse_shebang(const wstring &filename, wstring *version_tag, vector<wstring
         wprintf_s(L"Reading shebang from %s\n", filename.c_str());
     }
 
-    auto pline = read_first_line(filename);
-    if (!pline) {
+    wstring line(allArgs.get_allocator());
+    if (!read_first_line(filename, &line)) {
         if (verbose) {
             wprintf_s(L"Cannot read file \"%ls\"\n", filename.c_str());
         }
         return false;
     }
-    auto &line = *pline;
 
     if (line.length() < 2 || line[0] != '#' || line[1] != '!') {
         if (verbose) {
@@ -186,13 +406,15 @@ bool parse_shebang(const wstring &filename, wstring *version_tag, vector<wstring
     const wchar_t newline[] = L"\r\n";
     auto endl = std::find(line.cbegin(), line.cend(), L'\r');
     endl = std::find(line.cbegin(), endl, L'\n');
-    wstring shebang = { skip_shebang(line.cbegin(), endl), endl };
+    auto shebangStart = skip_shebang(line.cbegin(), endl);
+    wstring_view shebang(line.data() + (shebangStart - line.cbegin()), endl - shebangStart);
     if (verbose) {
-        wprintf_s(L"  Shebang: \"%s\"\n", shebang.c_str());
+        wprintf_s(L"  Shebang: \"%.*s\"\n", static_cast<int>(shebang.length()), shebang.data());
     }
 
 
-    auto args = split_args(shebang);
+    vector<wstring> args(allArgs.get_allocator());
+    split_args(shebang, args);
 
     if (args.size() == 0) {
         return false;
@@ -226,8 +448,10 @@ bool parse_shebang(const wstring &filename, wstring *version_tag, vector<wstring
     return true;
 }
 
-vector<wstring> parse_args(const wstring& line, wstring *version_tag) {
-    auto args = split_args(line);
+vector<wstring> parse_args(wstring_view line, wstring *version_tag, std::pmr::memory_resource *mem) {
+    vector<wstring> args(mem);
+    split_args(line, args);
+    expand_response_files(args);
     if (args.size() >= 1 && !extract_version(args, version_tag)) {
         args[0].clear();
     }
@@ -248,7 +472,7 @@ bool extract_version(vector<wstring>& args, wstring *version_tag) {
 
     // Check first argument
     if (args.size() >= 2) {
-        auto version_arg = args[1];
+        const auto &version_arg = args[1];
         if (version_arg.length() >= 1 && (version_arg[0] == L'2' || version_arg[0] == L'3')) {
             *version_tag = version_arg;
             if (verbose) {
@@ -263,19 +487,19 @@ bool extract_version(vector<wstring>& args, wstring *version_tag) {
     // Check process name
     if (!version_set && args.size() >= 1) {
         const wchar_t first_digits[] = L"23";
-        auto process = args[0];
+        const auto &process = args[0];
         auto lastBackslash = std::find(process.crbegin(), process.crend(), L'\\');
         auto lastDot = std::find(process.crbegin(), process.crend(), L'.').base() - 1;
         if (verbose) {
-            wprintf_s(L"Checking if '%ls' == '.exe'\n", wstring(lastDot, process.cend()).c_str());
+            wprintf_s(L"Checking if '%.*ls' == '.exe'\n", static_cast<int>(process.cend() - lastDot), process.data() + (lastDot - process.cbegin()));
         }
-        if (!equal_ignore_case(L".exe", { lastDot, process.cend() })) {
+        if (!equal_ignore_case(L".exe", { process.data() + (lastDot - process.cbegin()), static_cast<size_t>(process.cend() - lastDot) })) {
             lastDot = process.cend();
         }
         auto rstart = std::find(process.crbegin(), lastBackslash, L'/').base();
         auto start = std::find_first_of(rstart, lastDot, std::cbegin(first_digits), std::cend(first_digits));
         if (start != lastDot) {
-            *version_tag = { start, lastDot };
+            version_tag->assign(start, lastDot);
             if (verbose) {
                 wprintf_s(L"Found version '%ls' in process name\n", version_tag->c_str());
             }
@@ -286,10 +510,9 @@ bool extract_version(vector<wstring>& args, wstring *version_tag) {
 
     // Check shebang line
     if (!version_set && args.size() >= 2) {
-        auto filename = std::find_if(args.cbegin() + 1, args.cend(), [](const auto& a) {
-            return a.length() > 0 && a[0] != L'-';
-        });
-        if (filename != args.cend() && parse_shebang(*filename, version_tag, args)) {
+        bool is_code;
+        auto script = find_script(args, 1, &is_code);
+        if (script < args.size() && !is_code && parse_shebang(args[script], version_tag, args)) {
             if (verbose) {
                 wprintf_s(L"Found version '%ls' in shebang\n", version_tag->c_str());
             }
@@ -1,7 +1,13 @@
 #pragma once
 
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <vector>
 
-std::vector<std::wstring> parse_args(const std::wstring &line, std::wstring *version);
-
+// All returned strings are allocated from mem
+std::pmr::vector<std::pmr::wstring> parse_args(std::wstring_view line, std::pmr::wstring *version, std::pmr::memory_resource *mem);
+// Returns the index of the script, or of the code or module name following
+// '-c' or '-m' (which sets *is_code), searching from args[first]. Values of
+// options such as '-X' are skipped. Returns args.size() if there is no script.
+size_t find_script(const std::pmr::vector<std::pmr::wstring> &args, size_t first, bool *is_code);
@@ -10,6 +10,7 @@
 #include <algorithm>
 
 #include <memory>
+#include <memory_resource>
 #include <string>
 #include <sstream>
 #include <vector>
@@ -0,0 +1,95 @@
+#include "stdafx.h"
+#include "versions.h"
+
+using std::pmr::vector;
+using std::pmr::wstring;
+
+static uint16_t clamp_part(unsigned long value) {
+    return value > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(value);
+}
+
+uint32_t python_versions::intern(const wchar_t *s) {
+    auto hash = std::hash<std::wstring_view>()(s);
+    auto range = interned.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (wcscmp(str(it->second), s) == 0) {
+            return it->second;
+        }
+    }
+
+    auto offset = static_cast<uint32_t>(pool.size());
+    pool.append(s);
+    pool.push_back(L'\0');
+    interned.emplace(hash, offset);
+    return offset;
+}
+
+bool python_versions::add(const wchar_t *tag, const wchar_t *install_path, const wchar_t *exe_name, int priority) {
+    auto tag_offset = intern(tag);
+    if (!tags.insert(tag_offset).second) {
+        return false;
+    }
+
+    python_version pv = {};
+    pv.tag = tag_offset;
+    pv.install_path = intern(install_path);
+    pv.exe_name = intern(exe_name);
+    pv.priority = static_cast<uint8_t>(priority < 0 ? 0 : priority > 0xFF ? 0xFF : priority);
+
+    const wchar_t *c1 = tag;
+    wchar_t *c2;
+    auto major = std::wcstoul(c1, &c2, 10);
+    if (c1 != c2) {
+        pv.major = clamp_part(major);
+        if (*c2) {
+            c1 = c2 + 1;
+            auto minor = std::wcstoul(c1, &c2, 10);
+            if (c1 != c2) {
+                pv.minor = clamp_part(minor);
+            }
+        }
+    }
+
+    items.push_back(pv);
+    return true;
+}
+
+void python_versions::sort() {
+    // Rank distinct tags so that the final tie-break is by tag text
+    vector<uint32_t> ranked(items.get_allocator());
+    ranked.reserve(items.size());
+    for (const auto &pv : items) {
+        ranked.push_back(pv.tag);
+    }
+    std::sort(ranked.begin(), ranked.end(), [&](uint32_t x, uint32_t y) {
+        return wcscmp(str(x), str(y)) < 0;
+    });
+
+    for (auto &pv : items) {
+        auto ordinal = std::lower_bound(ranked.begin(), ranked.end(), pv.tag, [&](uint32_t x, uint32_t y) {
+            return wcscmp(str(x), str(y)) < 0;
+        }) - ranked.begin();
+        pv.sort_key =
+            (static_cast<uint64_t>(0xFFFF - pv.major) << 48) |
+            (static_cast<uint64_t>(0xFFFF - pv.minor) << 32) |
+            (static_cast<uint64_t>(pv.priority) << 24) |
+            (static_cast<uint64_t>(ordinal) & 0xFFFFFF);
+    }
+
+    std::sort(items.begin(), items.end());
+}
+
+wstring python_versions::full_path(const python_version &pv) const {
+    const wchar_t *install_path = str(pv.install_path);
+    const wchar_t *exe_name = str(pv.exe_name);
+    auto cchInstallPath = wcslen(install_path);
+
+    wstring res(pool.get_allocator());
+    res.reserve(cchInstallPath + wcslen(exe_name) + 1);
+    res.assign(install_path, cchInstallPath);
+    if (res.length() && res.back() != '\\') {
+        res.append(L"\\");
+    }
+    res.append(exe_name);
+    return res;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// A single discovered interpreter. Strings are stored as offsets into the
+// owning python_versions pool, and sort_key packs everything needed to order
+// versions so that sorting only compares integers.
+struct python_version {
+    // Bits 63-48: inverted major, 47-32: inverted minor, 31-24: priority,
+    // 23-0: tag ordinal. Smaller keys are preferred.
+    uint64_t sort_key;
+    uint32_t tag, install_path, exe_name;
+    uint16_t major, minor;
+    uint8_t priority;
+
+    bool operator==(const python_version& other) const {
+        return tag == other.tag;
+    }
+
+    bool operator<(const python_version& other) const {
+        return sort_key < other.sort_key;
+    }
+};
+
+class python_versions {
+public:
+    // All storage, including the pool and index, is allocated from mem.
+    explicit python_versions(std::pmr::memory_resource *mem)
+        : pool(mem), interned(mem), tags(mem), items(mem) {
+    }
+
+    // Adds a version, returning false if one with the same tag is already
+    // known. The first version added for a tag always wins.
+    bool add(const wchar_t *tag, const wchar_t *install_path, const wchar_t *exe_name, int priority);
+
+    // Assigns tag ordinals and sorts from most to least preferred.
+    void sort();
+
+    const wchar_t *str(uint32_t offset) const {
+        return pool.c_str() + offset;
+    }
+
+    std::pmr::wstring full_path(const python_version &pv) const;
+
+    std::pmr::vector<python_version>::const_iterator begin() const { return items.cbegin(); }
+    std::pmr::vector<python_version>::const_iterator end() const { return items.cend(); }
+    size_t size() const { return items.size(); }
+
+    // Avoids repeatedly growing the list when the number of versions about to
+    // be added is known, such as the subkey count of a registry key.
+    void reserve(size_t additional) { items.reserve(items.size() + additional); }
+
+private:
+    uint32_t intern(const wchar_t *s);
+
+    // All strings, each terminated with a null character so str() can be
+    // passed directly to Windows APIs.
+    std::pmr::wstring pool;
+    // Offsets of each string in the pool, keyed by the string's hash. Views
+    // into the pool would not survive it growing.
+    std::pmr::unordered_multimap<size_t, uint32_t> interned;
+    std::pmr::unordered_set<uint32_t> tags;
+    std::pmr::vector<python_version> items;
+};